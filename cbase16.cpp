@@ -1,4 +1,7 @@
 #include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
 #include <cstring>
 #include <exception>
 #include <filesystem>
@@ -6,7 +9,10 @@
 #include <iomanip>
 #include <iostream>
 #include <map>
+#include <set>
 #include <span>
+#include <string_view>
+#include <tuple>
 #include <unistd.h>
 #include <vector>
 
@@ -14,16 +20,30 @@
 #include <yaml-cpp/yaml.h>
 
 #if defined(__linux__)
+#include <fcntl.h>
+#include <linux/fs.h>
 #include <sys/ioctl.h>
 #elif defined(_WIN32)
 #include <Windows.h>
 #endif
 
+struct Tag {
+	size_t position;
+	size_t length;
+	std::string base;
+	std::string format;
+	size_t variable;
+};
+
 struct Template {
 	std::string name;
 	std::string data;
 	std::string extension;
 	std::string output;
+	std::filesystem::path file;
+	std::vector<Tag> tags;
+	std::vector<Tag> variables;
+	std::vector<std::string> unknown;
 };
 
 struct Scheme {
@@ -31,6 +51,19 @@ struct Scheme {
 	std::string name;
 	std::string author;
 	std::map<std::string, std::string> colors;
+	std::filesystem::path file;
+	std::filesystem::path source;
+};
+
+enum class Status {
+	ok,
+	missing,
+	stale,
+};
+
+struct Shard {
+	size_t index;
+	size_t count;
 };
 
 struct Terminal {
@@ -41,19 +74,54 @@ struct Terminal {
 constexpr int HEX_MIN_LENGTH = 6;
 constexpr int RGB_MIN_SIZE = 3;
 constexpr int RGB_DEC = 255;
+constexpr std::string_view VERSION = "0.5.4";
+constexpr uintmax_t MEBIBYTE = 1048576;
+constexpr uint64_t FNV_OFFSET = 14695981039346656037ULL;
+constexpr uint64_t FNV_PRIME = 1099511628211ULL;
+constexpr size_t READ_BUFFER_SIZE = 65536;
+constexpr std::array<std::string_view, 11> COLOR_FORMATS = {
+	"hex",   "hex-r", "hex-g", "hex-b", "hex-bgr", "rgb-r",
+	"rgb-g", "rgb-b", "dec-r", "dec-g", "dec-b",
+};
+constexpr std::array<std::string_view, 3> SCHEME_FORMATS = { "slug", "name", "author" };
+constexpr size_t TAR_BLOCK_SIZE = 512;
+constexpr size_t PALETTE_SIZE = 16;
+constexpr size_t FEATURE_SIZE = PALETTE_SIZE * 3;
 
 void clone(const std::filesystem::path &, const std::string &, const std::string &);
 void update(const std::filesystem::path &, bool);
+void analyze_template(Template &);
 auto get_template(const std::filesystem::path &) -> std::vector<Template>;
-auto get_scheme(const std::filesystem::path &) -> std::vector<Scheme>;
+auto get_scheme_node(const YAML::Node &, const std::string &) -> Scheme;
+auto get_scheme_file(const std::filesystem::path &) -> Scheme;
+inline auto is_scheme_bundle(const std::filesystem::path &) -> bool;
+auto read_scheme_bundle(const std::filesystem::path &) -> std::vector<Scheme>;
+auto get_scheme_bundle(const std::filesystem::path &) -> std::vector<Scheme>;
+auto get_scheme_entry(const std::filesystem::path &) -> std::vector<Scheme>;
+inline auto load_scheme(const Scheme &) -> Scheme;
 inline auto parse_template_dir(const std::filesystem::path &) -> std::vector<Template>;
 inline auto parse_scheme_dir(const std::filesystem::path &) -> std::vector<Scheme>;
+inline auto parse_scheme_entry_dir(const std::filesystem::path &) -> std::vector<Scheme>;
 inline auto hex_to_rgb(const std::string &) -> std::vector<int>;
 inline auto rgb_to_dec(const std::vector<int> &) -> std::vector<long double>;
-inline void replace_all(std::string &, const std::string &, const std::string &);
-void build(const std::filesystem::path &, const std::vector<std::string> &,
+inline auto is_resolved(const Tag &, const Scheme &) -> bool;
+inline auto get_variable(const Tag &, const Scheme &) -> std::string;
+auto render(const Template &, const Scheme &) -> std::string;
+inline auto get_output_file(const Template &, const Scheme &, const std::filesystem::path &)
+	-> std::filesystem::path;
+inline auto hash(std::string_view, uint64_t) -> uint64_t;
+auto compare_file(const std::filesystem::path &, const std::string &) -> Status;
+auto get_scheme_digest(const Scheme &) -> uint64_t;
+auto clone_file(const std::filesystem::path &, const std::filesystem::path &) -> bool;
+auto evict_render(const std::filesystem::path &, uintmax_t) -> size_t;
+auto get_shard_begin(const std::vector<Template> &, size_t, const Shard &) -> size_t;
+auto build(const std::filesystem::path &, const std::vector<std::string> &,
            const std::vector<std::string> &, const std::filesystem::path &,
-           const std::filesystem::path &, bool);
+           const std::filesystem::path &, size_t, size_t, const Shard &, bool, bool) -> int;
+inline auto rgb_to_lab(const std::vector<int> &) -> std::vector<float>;
+auto get_palette_feature(const std::vector<std::string> &) -> std::vector<float>;
+inline auto get_distance(const float *, const float *, size_t) -> float;
+void similar(const std::filesystem::path &, const std::vector<std::string> &, size_t, float);
 auto get_terminal_size() -> Terminal;
 void list_templates(const std::filesystem::path &, const bool &);
 void list_schemes(const std::filesystem::path &, const bool &);
@@ -137,6 +205,66 @@ update(const std::filesystem::path &opt_cache_dir, bool legacy)
 	git_libgit2_shutdown();
 }
 
+void
+analyze_template(Template &templet)
+{
+	std::map<std::string, size_t> variables;
+	std::set<std::string> unknown;
+	size_t close = 0;
+
+	// a tag ends at the first "}}" and starts at the last "{{" before it, which matches
+	// how a plain search and replace resolves runs like "{{{base00-hex}}}"
+	while ((close = templet.data.find("}}", close)) != std::string::npos) {
+		size_t open = close < 2 ? std::string::npos : templet.data.rfind("{{", close - 2);
+
+		if (open == std::string::npos ||
+		    (!templet.tags.empty() &&
+		     open < templet.tags.back().position + templet.tags.back().length)) {
+			close += 2;
+			continue;
+		}
+
+		Tag tag = { open, close + 2 - open, "", "", std::string::npos };
+		std::string content = templet.data.substr(open + 2, close - open - 2);
+
+		for (std::string_view format : SCHEME_FORMATS) {
+			if (content == "scheme-" + std::string(format)) {
+				tag.base = "scheme";
+				tag.format = format;
+			}
+		}
+
+		// "scheme" is read as the scheme name and can never be a color key
+		for (std::string_view format : COLOR_FORMATS) {
+			std::string suffix = "-" + std::string(format);
+
+			if (tag.format.empty() && content.size() > suffix.size() &&
+			    content.ends_with(suffix) &&
+			    content.substr(0, content.size() - suffix.size()) != "scheme") {
+				tag.base = content.substr(0, content.size() - suffix.size());
+				tag.format = format;
+			}
+		}
+
+		if (tag.format.empty()) {
+			unknown.insert(content);
+		} else {
+			auto [variable, inserted] =
+				variables.insert({ content, templet.variables.size() });
+
+			tag.variable = variable->second;
+
+			if (inserted)
+				templet.variables.emplace_back(tag);
+		}
+
+		templet.tags.emplace_back(tag);
+		close += 2;
+	}
+
+	templet.unknown.assign(unknown.begin(), unknown.end());
+}
+
 auto
 get_template(const std::filesystem::path &directory) -> std::vector<Template>
 {
@@ -172,6 +300,9 @@ get_template(const std::filesystem::path &directory) -> std::vector<Template>
 				buffer.close();
 			}
 
+			templet.file = file.path();
+			analyze_template(templet);
+
 			templates.emplace_back(templet);
 		}
 	}
@@ -199,71 +330,223 @@ parse_template_dir(const std::filesystem::path &directory) -> std::vector<Templa
 }
 
 auto
-get_scheme(const std::filesystem::path &directory) -> std::vector<Scheme>
+get_scheme_node(const YAML::Node &node, const std::string &slug) -> Scheme
 {
-	std::vector<Scheme> schemes;
+	Scheme scheme;
 
-	for (const std::filesystem::directory_entry &file :
-	     std::filesystem::directory_iterator(directory)) {
-		if (file.is_regular_file() && file.path().extension() == ".yaml") {
-			Scheme scheme;
+	scheme.slug = slug;
+
+	for (YAML::const_iterator it = node.begin(); it != node.end(); ++it) {
+		auto key = it->first.as<std::string>();
+		auto value = it->second.as<std::string>();
 
-			YAML::Node node = YAML::LoadFile(file.path().string());
+		if (key == "scheme")
+			scheme.name = value;
+		else if (key == "author")
+			scheme.author = value;
+		else
+			scheme.colors.insert({ key, value });
+	}
+
+	return scheme;
+}
 
-			scheme.slug = file.path().stem().string();
+auto
+get_scheme_file(const std::filesystem::path &file) -> Scheme
+{
+	Scheme scheme = get_scheme_node(YAML::LoadFile(file.string()), file.stem().string());
+	scheme.source = file;
+
+	return scheme;
+}
+
+inline auto
+is_scheme_bundle(const std::filesystem::path &file) -> bool
+{
+	return file.extension() == ".tar" ||
+	       (file.extension() == ".yaml" && file.stem().extension() == ".bundle");
+}
 
-			for (YAML::const_iterator it = node.begin(); it != node.end(); ++it) {
-				auto key = it->first.as<std::string>();
-				auto value = it->second.as<std::string>();
+auto
+read_scheme_bundle(const std::filesystem::path &file) -> std::vector<Scheme>
+{
+	std::vector<Scheme> schemes;
 
-				if (key == "scheme")
-					scheme.name = value;
-				else if (key == "author")
-					scheme.author = value;
-				else
-					scheme.colors.insert({ key, value });
+	if (file.extension() == ".yaml") {
+		// every document maps slugs to schemes, e.g. "gruvbox-dark: { scheme: ... }"
+		for (const YAML::Node &document : YAML::LoadAllFromFile(file.string())) {
+			for (YAML::const_iterator it = document.begin(); it != document.end();
+			     ++it) {
+				if (it->second.IsMap())
+					schemes.emplace_back(get_scheme_node(
+						it->second, it->first.as<std::string>()));
 			}
+		}
+
+		return schemes;
+	}
+
+	std::ifstream buffer(file, std::ios::binary);
+	std::vector<char> header(TAR_BLOCK_SIZE);
+	std::string long_name;
+
+	if (!buffer.good())
+		throw std::runtime_error("cannot read archive");
 
-			schemes.emplace_back(scheme);
+	// ustar members are read in order: a header block, then the data padded to a block
+	while (buffer.read(header.data(), (long)header.size())) {
+		if (header[0] == '\0')
+			break;
+
+		std::string name(header.data(), strnlen(header.data(), 100));
+		std::string prefix(&header[345], strnlen(&header[345], 155));
+		// GNU base-256 sizes set the high bit and are only used for members over 8 GiB
+		if ((header[124] & 0x80) != 0)
+			throw std::runtime_error("unsupported member size field");
+
+		size_t size = std::stoul(std::string(&header[124], 12), nullptr, 8);
+		char type = header[156];
+
+		std::string data(size, '\0');
+		buffer.read(data.data(), (long)size);
+		buffer.ignore((long)((TAR_BLOCK_SIZE - size % TAR_BLOCK_SIZE) % TAR_BLOCK_SIZE));
+
+		if (!buffer.good())
+			throw std::runtime_error("truncated archive");
+
+		if (type == 'L') {
+			long_name = data.c_str();
+			continue;
 		}
+
+		// pax headers are "<length> <key>=<value>\n" records, only the path matters here
+		if (type == 'x') {
+			size_t path = data.find(" path=");
+
+			if (path != std::string::npos)
+				long_name = data.substr(path + 6, data.find('\n', path) - path - 6);
+
+			continue;
+		}
+
+		if (!long_name.empty())
+			name = long_name;
+		else if (!prefix.empty())
+			name = prefix + "/" + name;
+
+		long_name.clear();
+
+		std::filesystem::path member = name;
+
+		if ((type == '0' || type == '\0') && member.extension() == ".yaml")
+			schemes.emplace_back(
+				get_scheme_node(YAML::Load(data), member.stem().string()));
 	}
 
+	if (!buffer && buffer.gcount() != 0)
+		throw std::runtime_error("truncated archive");
+
 	return schemes;
 }
 
+auto
+get_scheme_bundle(const std::filesystem::path &file) -> std::vector<Scheme>
+{
+	// one broken bundle should not take down every command reading the directory
+	try {
+		std::vector<Scheme> schemes = read_scheme_bundle(file);
+
+		for (Scheme &scheme : schemes)
+			scheme.source = file;
+
+		return schemes;
+	} catch (std::exception &e) {
+		std::cerr << "warning: skipping " << file.string() << ": " << e.what()
+			  << std::endl;
+		return {};
+	}
+}
+
+auto
+get_scheme_entry(const std::filesystem::path &directory) -> std::vector<Scheme>
+{
+	// plain scheme files only carry their slug and path and are loaded when needed,
+	// bundles are read in one pass since their slugs are only known after reading
+	std::vector<Scheme> entries;
+
+	for (const std::filesystem::directory_entry &file :
+	     std::filesystem::directory_iterator(directory)) {
+		if (!file.is_regular_file())
+			continue;
+
+		if (is_scheme_bundle(file.path())) {
+			std::vector<Scheme> bundle = get_scheme_bundle(file.path());
+			entries.insert(entries.end(), bundle.begin(), bundle.end());
+		} else if (file.path().extension() == ".yaml") {
+			Scheme entry;
+			entry.slug = file.path().stem().string();
+			entry.file = file.path();
+			entry.source = file.path();
+			entries.emplace_back(entry);
+		}
+	}
+
+	return entries;
+}
+
+inline auto
+load_scheme(const Scheme &entry) -> Scheme
+{
+	return entry.file.empty() ? entry : get_scheme_file(entry.file);
+}
+
 inline auto
 parse_scheme_dir(const std::filesystem::path &directory) -> std::vector<Scheme>
 {
 	std::vector<Scheme> schemes;
 
+	for (const Scheme &entry : parse_scheme_entry_dir(directory))
+		schemes.emplace_back(load_scheme(entry));
+
+	return schemes;
+}
+
+inline auto
+parse_scheme_entry_dir(const std::filesystem::path &directory) -> std::vector<Scheme>
+{
+	std::vector<Scheme> entries;
+
 	for (const std::filesystem::directory_entry &entry :
 	     std::filesystem::directory_iterator(directory)) {
+		if (std::filesystem::is_regular_file(entry) && is_scheme_bundle(entry.path())) {
+			std::vector<Scheme> bundle = get_scheme_bundle(entry.path());
+			entries.insert(entries.end(), bundle.begin(), bundle.end());
+			continue;
+		}
+
 		if (!std::filesystem::is_directory(entry))
 			continue;
 
-		std::vector<Scheme> parse_schemes = get_scheme(entry);
-		schemes.insert(schemes.end(), parse_schemes.begin(), parse_schemes.end());
+		std::vector<Scheme> parse_entries = get_scheme_entry(entry);
+		entries.insert(entries.end(), parse_entries.begin(), parse_entries.end());
 	}
 
-	return schemes;
+	return entries;
 }
 
 inline auto
 hex_to_rgb(const std::string &hex) -> std::vector<int>
 {
 	std::vector<int> rgb(3);
-	std::stringstream ss;
-	std::string str;
 
 	if (hex.size() != HEX_MIN_LENGTH)
 		throw std::runtime_error("error: hex does not reach minimum length of 6");
 
-#pragma omp parallel for default(none) shared(hex, str, ss, rgb)
+#pragma omp parallel for default(none) shared(hex, rgb)
 	for (int i = 0; i < 3; ++i) {
-		str = hex.substr(i * 2, 2);
-		ss << std::hex << str;
+		std::stringstream ss;
+		ss << std::hex << hex.substr(i * 2, 2);
 		ss >> rgb[i];
-		ss.clear();
 	}
 
 	return rgb;
@@ -284,47 +567,283 @@ rgb_to_dec(const std::vector<int> &rgb) -> std::vector<long double>
 	return dec;
 }
 
-inline void
-replace_all(std::string &str, const std::string &from, const std::string &to)
+inline auto
+is_resolved(const Tag &tag, const Scheme &s) -> bool
 {
-	if (from.empty())
-		return;
+	if (tag.format.empty())
+		return false;
 
-	size_t start_pos = 0;
+	if (tag.base == "scheme")
+		return true;
 
-	while ((start_pos = str.find(from, start_pos)) != std::string::npos) {
-		str.replace(start_pos, from.length(), to);
-		start_pos += to.length();
+	auto color = s.colors.find(tag.base);
+
+	return color != s.colors.end() && color->second.size() == HEX_MIN_LENGTH;
+}
+
+inline auto
+get_variable(const Tag &tag, const Scheme &s) -> std::string
+{
+	if (tag.base == "scheme") {
+		if (tag.format == "slug")
+			return s.slug;
+		if (tag.format == "name")
+			return s.name;
+		return s.author;
 	}
+
+	const std::string &color = s.colors.at(tag.base);
+
+	if (tag.format == "hex")
+		return color;
+
+	if (tag.format == "hex-bgr")
+		return color.substr(0, 2) + color.substr(2, 2) + color.substr(4, 2);
+
+	// the last letter of every other format picks the channel
+	size_t channel = std::string("rgb").find(tag.format.back());
+
+	if (tag.format.starts_with("hex"))
+		return color.substr(channel * 2, 2);
+
+	std::vector<int> rgb = hex_to_rgb(color);
+
+	if (tag.format.starts_with("rgb"))
+		return std::to_string(rgb[channel]);
+
+	return std::to_string(rgb_to_dec(rgb)[channel]);
 }
 
-void
+auto
+render(const Template &t, const Scheme &s) -> std::string
+{
+	std::string data;
+	std::vector<std::string> values(t.variables.size());
+	std::vector<bool> resolved(t.variables.size());
+	size_t position = 0;
+
+	// each variable the template uses is computed once, however often it appears
+	for (size_t i = 0; i < t.variables.size(); ++i) {
+		resolved[i] = is_resolved(t.variables[i], s);
+
+		if (resolved[i])
+			values[i] = get_variable(t.variables[i], s);
+	}
+
+	data.reserve(t.data.size());
+
+	// anything that cannot be resolved is left in place as before
+	for (const Tag &tag : t.tags) {
+		data.append(t.data, position, tag.position - position);
+
+		if (tag.variable != std::string::npos && resolved[tag.variable])
+			data.append(values[tag.variable]);
+		else
+			data.append(t.data, tag.position, tag.length);
+
+		position = tag.position + tag.length;
+	}
+
+	data.append(t.data, position);
+
+	return data;
+}
+
+inline auto
+get_output_file(const Template &t, const Scheme &s, const std::filesystem::path &output_dir)
+	-> std::filesystem::path
+{
+	return output_dir / t.name / t.output / ("base16-" + s.slug + t.extension);
+}
+
+inline auto
+hash(std::string_view data, uint64_t digest = FNV_OFFSET) -> uint64_t
+{
+	for (const char c : data) {
+		digest ^= (unsigned char)c;
+		digest *= FNV_PRIME;
+	}
+
+	return digest;
+}
+
+auto
+compare_file(const std::filesystem::path &file, const std::string &data) -> Status
+{
+	std::error_code error;
+	uintmax_t size = std::filesystem::file_size(file, error);
+
+	if (error || !std::filesystem::is_regular_file(file))
+		return Status::missing;
+
+	if (size != data.size())
+		return Status::stale;
+
+	std::ifstream buffer(file, std::ios::binary);
+	std::vector<char> chunk(READ_BUFFER_SIZE);
+	uint64_t digest = FNV_OFFSET;
+
+	while (buffer.read(chunk.data(), (long)chunk.size()) || buffer.gcount() > 0)
+		digest = hash({ chunk.data(), (size_t)buffer.gcount() }, digest);
+
+	return digest == hash(data) ? Status::ok : Status::stale;
+}
+
+auto
+get_scheme_digest(const Scheme &s) -> uint64_t
+{
+	uint64_t digest = FNV_OFFSET;
+
+	// every field is length-prefixed so no two different schemes read as the same bytes
+	auto field = [&digest](const std::string &value) {
+		digest = hash(value, hash(std::to_string(value.size()) + ":", digest));
+	};
+
+	field(s.slug);
+	field(s.name);
+	field(s.author);
+
+	// colors is an ordered map, so equal palettes always hash the same way
+	for (const auto &[base, color] : s.colors) {
+		field(base);
+		field(color);
+	}
+
+	return digest;
+}
+
+auto
+clone_file(const std::filesystem::path &from, const std::filesystem::path &to) -> bool
+{
+#if defined(__linux__)
+	int source = open(from.c_str(), O_RDONLY | O_CLOEXEC);
+	int target = open(to.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+	// NOLINTNEXTLINE (cppcoreguidelines-pro-type-vararg)
+	bool cloned = source >= 0 && target >= 0 && ioctl(target, FICLONE, source) == 0;
+
+	if (source >= 0)
+		close(source);
+	if (target >= 0)
+		close(target);
+
+	if (cloned)
+		return true;
+#endif
+
+	std::error_code error;
+	std::filesystem::copy_file(from, to, std::filesystem::copy_options::overwrite_existing,
+	                           error);
+
+	return !error;
+}
+
+auto
+evict_render(const std::filesystem::path &directory, uintmax_t limit) -> size_t
+{
+	// other runs may touch or remove entries meanwhile, so every entry is stat'ed once
+	// and failures are skipped rather than thrown
+	std::vector<std::tuple<std::filesystem::file_time_type, uintmax_t, std::filesystem::path>>
+		entries;
+	std::error_code error;
+	uintmax_t total = 0;
+	size_t evicted = 0;
+
+	for (std::filesystem::recursive_directory_iterator it(directory, error), end;
+	     !error && it != end; it.increment(error)) {
+		std::error_code stat_error;
+
+		if (!it->is_regular_file(stat_error) || stat_error)
+			continue;
+
+		uintmax_t size = it->file_size(stat_error);
+		if (stat_error)
+			continue;
+
+		std::filesystem::file_time_type time = it->last_write_time(stat_error);
+		if (stat_error)
+			continue;
+
+		total += size;
+		entries.emplace_back(time, size, it->path());
+	}
+
+	if (total <= limit)
+		return 0;
+
+	// entries are touched on every hit, so the oldest write time is least recently used
+	std::sort(entries.begin(), entries.end());
+
+	for (const auto &[time, size, path] : entries) {
+		if (total <= limit)
+			break;
+
+		if (std::filesystem::remove(path, error)) {
+			total -= size;
+			evicted += 1;
+		}
+	}
+
+	return evicted;
+}
+
+auto
+get_shard_begin(const std::vector<Template> &templates, size_t num_of_scheme, const Shard &shard)
+	-> size_t
+{
+	// jobs are ordered scheme-major and each job costs the size of its template, a job
+	// belongs to the shard its cost midpoint falls in so shards split the total evenly
+	std::vector<uint64_t> prefix = { 0 };
+
+	for (const Template &t : templates)
+		prefix.emplace_back(prefix.back() + t.data.size() + 1);
+
+	uint64_t row = prefix.back();
+	uint64_t total = row * num_of_scheme;
+	size_t first = 0;
+	size_t last = num_of_scheme * templates.size();
+
+	while (first < last) {
+		size_t job = first + (last - first) / 2;
+		size_t t = job % templates.size();
+		uint64_t midpoint = 2 * ((job / templates.size()) * row + prefix[t]) +
+		                    (prefix[t + 1] - prefix[t]);
+
+		if (midpoint * shard.count / (2 * total) < shard.index)
+			first = job + 1;
+		else
+			last = job;
+	}
+
+	return first;
+}
+
+auto
 build(const std::filesystem::path &opt_cache_dir, const std::vector<std::string> &opt_templates,
       const std::vector<std::string> &opt_schemes, const std::filesystem::path &opt_build_dir,
-      const std::filesystem::path &opt_output, bool make)
+      const std::filesystem::path &opt_output, size_t opt_batch, size_t opt_render_cache,
+      const Shard &opt_shard, bool opt_verify, bool make) -> int
 {
 	std::vector<Template> templates;
-	std::vector<Scheme> schemes;
+	std::vector<Scheme> scheme_entries;
 
 	if (make) {
 		bool is_valid_dir = false;
 
 		for (const std::filesystem::directory_entry &file :
 		     std::filesystem::directory_iterator(opt_build_dir)) {
-			if (file.is_regular_file() && file.path().extension() == ".yaml") {
+			if (file.is_regular_file() && (file.path().extension() == ".yaml" ||
+			                               is_scheme_bundle(file.path()))) {
 				is_valid_dir = true;
 				break;
 			}
 		}
 
-		if (is_valid_dir) {
-			std::vector<Scheme> parse_scheme = get_scheme(opt_build_dir);
-			schemes.insert(schemes.begin(), parse_scheme.begin(), parse_scheme.end());
-		} else {
-			schemes = parse_scheme_dir(opt_cache_dir / "schemes");
-		}
+		if (is_valid_dir)
+			scheme_entries = get_scheme_entry(opt_build_dir);
+		else
+			scheme_entries = parse_scheme_entry_dir(opt_cache_dir / "schemes");
 	} else {
-		schemes = parse_scheme_dir(opt_cache_dir / "schemes");
+		scheme_entries = parse_scheme_entry_dir(opt_cache_dir / "schemes");
 	}
 
 	if (make) {
@@ -340,85 +859,490 @@ build(const std::filesystem::path &opt_cache_dir, const std::vector<std::string>
 		templates = parse_template_dir(opt_cache_dir / "templates");
 	}
 
-#pragma omp parallel for default(none) shared(opt_templates, opt_schemes, templates, schemes, \
-                                              opt_build_dir, opt_output, make, std::cerr)
-	for (const Scheme &s : schemes) {
-		if (!opt_schemes.empty() &&
-		    std::find(opt_schemes.begin(), opt_schemes.end(), s.slug) == opt_schemes.end())
-			continue;
-#pragma omp parallel for default(none) \
-	shared(opt_templates, templates, s, opt_build_dir, opt_output, make, std::cerr)
-		for (Template t : templates) {
-			if (!opt_templates.empty() &&
-			    std::find(opt_templates.begin(), opt_templates.end(), t.name) ==
-			            opt_templates.end())
+	// filter by slug before parsing so unselected schemes are never loaded
+	if (!opt_schemes.empty()) {
+		std::erase_if(scheme_entries, [&](const Scheme &s) {
+			return std::find(opt_schemes.begin(), opt_schemes.end(), s.slug) ==
+			       opt_schemes.end();
+		});
+	}
+
+	if (!opt_templates.empty()) {
+		std::erase_if(templates, [&](const Template &t) {
+			return std::find(opt_templates.begin(), opt_templates.end(), t.name) ==
+			       opt_templates.end();
+		});
+	}
+
+	std::filesystem::path output_dir = opt_output;
+
+	if (make && opt_output.empty())
+		output_dir = opt_build_dir;
+
+	if (templates.empty())
+		return 0;
+
+	// every shard must see the same job order regardless of directory iteration order,
+	// ties fall back to the source file and duplicate slugs within a bundle keep their
+	// order in it
+	std::stable_sort(scheme_entries.begin(), scheme_entries.end(),
+	                 [](const Scheme &a, const Scheme &b) {
+				 return std::tie(a.slug, a.source) < std::tie(b.slug, b.source);
+			 });
+
+	std::stable_sort(templates.begin(), templates.end(),
+	                 [](const Template &a, const Template &b) {
+				 return std::tie(a.name, a.output, a.extension, a.file) <
+				        std::tie(b.name, b.output, b.extension, b.file);
+			 });
+
+	// unknown tags are never replaced and end up verbatim in every output
+	for (const Template &t : templates) {
+		for (const std::string &tag : t.unknown)
+			std::cerr << "warning: " << t.file.string() << ": unknown tag {{" << tag
+				  << "}}" << std::endl;
+	}
+
+	std::vector<std::map<std::string, long>> unresolved(templates.size());
+
+	size_t shard_begin = get_shard_begin(templates, scheme_entries.size(), opt_shard);
+	size_t shard_end = get_shard_begin(templates, scheme_entries.size(),
+	                                   { opt_shard.index + 1, opt_shard.count });
+	bool use_manifest = opt_shard.count > 1 && !opt_verify;
+	std::filesystem::path manifest_file =
+		output_dir / "shards" /
+		("shard-" + std::to_string(opt_shard.index + 1) + "-of-" +
+	         std::to_string(opt_shard.count) + ".yaml");
+	std::ofstream manifest_stream;
+
+	// kept out of the top level, which make also scans for scheme files
+	if (use_manifest) {
+		std::filesystem::create_directories(manifest_file.parent_path());
+		manifest_stream.open(manifest_file);
+	}
+
+	// the emitter writes straight to the file so file names never pile up in memory
+	YAML::Emitter manifest(manifest_stream);
+
+	if (use_manifest) {
+		manifest << YAML::BeginMap;
+		manifest << YAML::Key << "shard" << YAML::Value << opt_shard.index + 1;
+		manifest << YAML::Key << "count" << YAML::Value << opt_shard.count;
+		manifest << YAML::Key << "jobs" << YAML::Value
+			 << scheme_entries.size() * templates.size();
+		manifest << YAML::Key << "begin" << YAML::Value << shard_begin;
+		manifest << YAML::Key << "end" << YAML::Value << shard_end;
+		manifest << YAML::Key << "files" << YAML::Value << YAML::BeginSeq;
+	}
+
+	std::filesystem::path render_dir = opt_cache_dir / "render";
+	bool use_render_cache = opt_render_cache != 0 && !opt_verify;
+	std::vector<uint64_t> template_digest;
+	long hit = 0;
+	long miss = 0;
+
+	if (use_render_cache) {
+		std::filesystem::create_directories(render_dir);
+
+		for (const Template &t : templates)
+			template_digest.emplace_back(hash(t.data, hash(VERSION)));
+	}
+
+	// templates stay resident, schemes are loaded and released one batch at a time
+	size_t batch = opt_batch == 0 ? scheme_entries.size() : opt_batch;
+	int failure = 0;
+
+	size_t scheme_first = shard_begin / templates.size();
+	size_t scheme_last = (shard_end + templates.size() - 1) / templates.size();
+
+	for (size_t begin = scheme_first; begin < scheme_last; begin += batch) {
+		size_t end = std::min(begin + batch, scheme_last);
+
+		std::vector<Scheme> schemes;
+		std::vector<uint64_t> scheme_digest;
+		schemes.reserve(end - begin);
+
+		for (size_t i = begin; i < end; ++i) {
+			schemes.emplace_back(load_scheme(scheme_entries[i]));
+
+			if (use_render_cache)
+				scheme_digest.emplace_back(get_scheme_digest(schemes.back()));
+		}
+
+		long jobs = (long)(schemes.size() * templates.size());
+		long job_first = (long)(std::max(shard_begin, begin * templates.size()) -
+		                        begin * templates.size());
+		long job_last = (long)(std::min(shard_end, end * templates.size()) -
+		                       begin * templates.size());
+		std::vector<Status> status(jobs, Status::ok);
+
+#pragma omp parallel for schedule(dynamic) default(none)                               \
+	shared(job_first, job_last, templates, schemes, output_dir, opt_verify, status,     \
+	       use_render_cache, render_dir, template_digest, scheme_digest, unresolved,      \
+	       std::cerr) reduction(+ : hit, miss)
+		for (long job = job_first; job < job_last; ++job) {
+			const Scheme &s = schemes[job / templates.size()];
+			const Template &t = templates[job % templates.size()];
+
+			for (const Tag &tag : t.variables) {
+				if (!is_resolved(tag, s)) {
+#pragma omp critical
+					unresolved[job % templates.size()]
+						  [t.data.substr(tag.position, tag.length)] += 1;
+				}
+			}
+
+			std::filesystem::path output_file = get_output_file(t, s, output_dir);
+
+			if (opt_verify) {
+				status[job] = compare_file(output_file, render(t, s));
 				continue;
+			}
 
-			for (const auto &[base, color] : s.colors) {
-				std::vector<std::string> hex = { color.substr(0, 2),
-					                         color.substr(2, 2),
-					                         color.substr(4, 2) };
+			std::filesystem::create_directories(output_file.parent_path());
 
-				std::vector<int> rgb;
-				std::vector<long double> dec;
+			std::filesystem::path cache_file;
 
-				try {
-					rgb = hex_to_rgb(color);
-					dec = rgb_to_dec(rgb);
-				} catch (std::runtime_error &e) {
+			if (use_render_cache) {
+				std::stringstream key;
+				key << std::hex << std::setfill('0') << std::setw(16)
+				    << hash(std::to_string(scheme_digest[job / templates.size()]),
+				            template_digest[job % templates.size()]);
+
+				cache_file = render_dir / key.str().substr(0, 2) / key.str();
+
+				if (std::filesystem::is_regular_file(cache_file) &&
+				    clone_file(cache_file, output_file)) {
+					auto now = std::filesystem::file_time_type::clock::now();
+					std::error_code error;
+					std::filesystem::last_write_time(cache_file, now, error);
+					hit += 1;
 					continue;
 				}
 
-				replace_all(t.data, "{{" + base + "-hex-r" + "}}", hex[0]);
-				replace_all(t.data, "{{" + base + "-hex-g" + "}}", hex[1]);
-				replace_all(t.data, "{{" + base + "-hex-b" + "}}", hex[2]);
-
-				replace_all(t.data, "{{" + base + "-rgb-r" + "}}",
-				            std::to_string(rgb[0]));
-				replace_all(t.data, "{{" + base + "-rgb-g" + "}}",
-				            std::to_string(rgb[1]));
-				replace_all(t.data, "{{" + base + "-rgb-b" + "}}",
-				            std::to_string(rgb[2]));
-
-				replace_all(t.data, "{{" + base + "-dec-r" + "}}",
-				            std::to_string(dec[0]));
-				replace_all(t.data, "{{" + base + "-dec-g" + "}}",
-				            std::to_string(dec[1]));
-				replace_all(t.data, "{{" + base + "-dec-b" + "}}",
-				            std::to_string(dec[2]));
-
-				replace_all(t.data, "{{" + base + "-hex" + "}}", color);
-				replace_all(t.data, "{{" + base + "-hex-bgr" + "}}",
-				            hex[0] + hex[1] + hex[2]);
+				miss += 1;
 			}
 
-			replace_all(t.data, "{{scheme-slug}}", s.slug);
-			replace_all(t.data, "{{scheme-name}}", s.name);
-			replace_all(t.data, "{{scheme-author}}", s.author);
+			std::string data = render(t, s);
+			std::ofstream file(output_file);
 
-			std::filesystem::path output_dir;
+			file << data;
+			file.close();
 
-			if (make) {
-				if (opt_output.empty())
-					output_dir = opt_build_dir / t.name / t.output;
-				else
-					output_dir = opt_output / t.name / t.output;
-			} else {
-				output_dir = opt_output / t.name / t.output;
+			if (!file.good()) {
+				std::cerr << "error: cannot create " << output_file << std::endl;
+				continue;
 			}
 
-			std::filesystem::create_directories(output_dir);
-			std::ofstream output_file(output_dir / ("base16-" + s.slug + t.extension));
+			if (!use_render_cache)
+				continue;
+
+			// write under a unique name so concurrent runs never see a partial entry
+			std::error_code error;
+			std::filesystem::path temp_file = cache_file;
+			temp_file += "." + std::to_string(getpid()) + "." + std::to_string(job);
 
-			try {
-				output_file << t.data;
-				output_file.close();
-			} catch (std::exception const &e) {
-				std::cerr << "error: cannot create " << output_dir << "base16-"
-					  << s.slug << t.extension << std::endl;
+			std::filesystem::create_directories(cache_file.parent_path(), error);
+			std::ofstream cache(temp_file, std::ios::binary);
+
+			cache << data;
+			cache.close();
+
+			if (cache.good())
+				std::filesystem::rename(temp_file, cache_file, error);
+			else
+				std::filesystem::remove(temp_file, error);
+		}
+
+		if (!opt_verify) {
+			if (!use_manifest)
 				continue;
+
+			for (long job = job_first; job < job_last; ++job) {
+				std::filesystem::path output_file =
+					get_output_file(templates[job % templates.size()],
+				                        schemes[job / templates.size()], "");
+				manifest << output_file.generic_string();
+			}
+
+			continue;
+		}
+
+		for (long job = job_first; job < job_last; ++job) {
+			std::filesystem::path output_file =
+				get_output_file(templates[job % templates.size()],
+			                        schemes[job / templates.size()], output_dir);
+
+			if (status[job] == Status::missing)
+				std::cout << "missing: " << output_file.string() << std::endl;
+			else if (status[job] == Status::stale)
+				std::cout << "stale: " << output_file.string() << std::endl;
+
+			if (status[job] != Status::ok)
+				failure += 1;
+		}
+	}
+
+	for (size_t i = 0; i < templates.size(); ++i) {
+		for (const auto &[tag, count] : unresolved[i])
+			std::cerr << "warning: " << templates[i].file.string() << ": " << tag
+				  << " is not defined by " << count << " scheme(s)" << std::endl;
+	}
+
+	if (use_render_cache) {
+		size_t evicted = evict_render(render_dir, opt_render_cache * MEBIBYTE);
+
+		std::cout << "render cache: " << hit << " hit, " << miss << " miss, " << evicted
+			  << " evicted" << std::endl;
+	}
+
+	if (use_manifest) {
+		manifest << YAML::EndSeq << YAML::EndMap;
+
+		manifest_stream << std::endl;
+		manifest_stream.close();
+
+		if (!manifest_stream.good())
+			std::cerr << "error: cannot create shard manifest " << manifest_file
+				  << std::endl;
+	}
+
+	// a scheme filter or shard leaves other files in place, so they are not extra
+	if (!opt_verify || !opt_schemes.empty() || opt_shard.count > 1)
+		return failure;
+
+	// files are matched by pattern instead of keeping every expected path around, an
+	// expected file sits in a template's output directory and is named after a slug
+	std::set<std::string> slugs;
+	std::set<std::string> template_names;
+	std::string prefix = "base16-";
+
+	for (const Scheme &entry : scheme_entries)
+		slugs.insert(entry.slug);
+
+	for (const Template &t : templates)
+		template_names.insert(t.name);
+
+	for (const std::string &name : template_names) {
+		if (!std::filesystem::is_directory(output_dir / name))
+			continue;
+
+		for (const std::filesystem::directory_entry &file :
+		     std::filesystem::recursive_directory_iterator(output_dir / name)) {
+			if (!file.is_regular_file())
+				continue;
+
+			// output in config.yaml may be "./scripts" or ".", directory walks are not
+			std::filesystem::path path = file.path().lexically_normal();
+			std::string filename = file.path().filename().string();
+
+			bool is_expected = std::any_of(
+				templates.begin(), templates.end(), [&](const Template &t) {
+					if (t.name != name || !filename.starts_with(prefix) ||
+					    !filename.ends_with(t.extension) ||
+					    filename.size() <= prefix.size() + t.extension.size())
+						return false;
+
+					size_t length = filename.size() - t.extension.size();
+					std::string slug = filename.substr(prefix.size(),
+					                                   length - prefix.size());
+
+					std::filesystem::path expected =
+						output_dir / t.name / t.output / filename;
+
+					return slugs.contains(slug) &&
+					       expected.lexically_normal() == path;
+				});
+
+			if (!is_expected) {
+				std::cout << "extra: " << file.path().string() << std::endl;
+				failure += 1;
+			}
+		}
+	}
+
+	return failure;
+}
+
+inline auto
+rgb_to_lab(const std::vector<int> &rgb) -> std::vector<float>
+{
+	std::vector<float> linear(3);
+
+	if (rgb.size() != RGB_MIN_SIZE)
+		throw std::runtime_error("error: rgb value does not exceed minimum size of 3");
+
+	for (int i = 0; i < 3; ++i) {
+		float c = (float)rgb[i] / RGB_DEC;
+		linear[i] = c <= 0.04045F ? c / 12.92F : std::pow((c + 0.055F) / 1.055F, 2.4F);
+	}
+
+	// sRGB to CIE XYZ under D65, normalized by the reference white
+	std::vector<float> xyz = {
+		(0.4124564F * linear[0] + 0.3575761F * linear[1] + 0.1804375F * linear[2]) /
+			0.95047F,
+		0.2126729F * linear[0] + 0.7151522F * linear[1] + 0.0721750F * linear[2],
+		(0.0193339F * linear[0] + 0.1191920F * linear[1] + 0.9503041F * linear[2]) /
+			1.08883F,
+	};
+
+	for (float &t : xyz)
+		t = t > 216.0F / 24389.0F ? std::cbrt(t) : (24389.0F / 27.0F * t + 16.0F) / 116.0F;
+
+	return { 116.0F * xyz[1] - 16.0F, 500.0F * (xyz[0] - xyz[1]), 200.0F * (xyz[1] - xyz[2]) };
+}
+
+auto
+get_palette_feature(const std::vector<std::string> &palette) -> std::vector<float>
+{
+	// laid out as all L, then all a, then all b so distances vectorize per channel
+	std::vector<float> feature(FEATURE_SIZE, NAN);
+
+	for (size_t i = 0; i < palette.size() && i < PALETTE_SIZE; ++i) {
+		std::vector<float> lab;
+
+		// hex_to_rgb only checks the length and reads anything else as 0
+		if (!std::all_of(palette[i].begin(), palette[i].end(),
+		                 [](unsigned char c) { return std::isxdigit(c); }))
+			continue;
+
+		try {
+			lab = rgb_to_lab(hex_to_rgb(palette[i]));
+		} catch (std::exception &e) {
+			continue;
+		}
+
+		feature[i] = lab[0];
+		feature[PALETTE_SIZE + i] = lab[1];
+		feature[2 * PALETTE_SIZE + i] = lab[2];
+	}
+
+	return feature;
+}
+
+inline auto
+get_distance(const float *a, const float *b, size_t size) -> float
+{
+	float sum = 0;
+
+#pragma omp simd reduction(+ : sum)
+	for (size_t i = 0; i < size; ++i) {
+		float l = a[i] - b[i];
+		float u = a[PALETTE_SIZE + i] - b[PALETTE_SIZE + i];
+		float v = a[2 * PALETTE_SIZE + i] - b[2 * PALETTE_SIZE + i];
+		sum += std::sqrt(l * l + u * u + v * v);
+	}
+
+	// mean CIE76 delta E across the compared slots, NaN if a color is missing
+	return sum / (float)size;
+}
+
+void
+similar(const std::filesystem::path &opt_cache_dir, const std::vector<std::string> &queries,
+        size_t opt_count, float opt_threshold)
+{
+	std::vector<Scheme> schemes = parse_scheme_dir(opt_cache_dir / "schemes");
+	std::vector<float> features(schemes.size() * FEATURE_SIZE);
+
+	std::sort(schemes.begin(), schemes.end(),
+	          [](const Scheme &a, const Scheme &b) { return a.slug < b.slug; });
+
+#pragma omp parallel for default(none) shared(schemes, features)
+	for (size_t i = 0; i < schemes.size(); ++i) {
+		std::vector<std::string> palette;
+
+		for (size_t slot = 0; slot < PALETTE_SIZE; ++slot) {
+			std::stringstream base;
+			base << "base" << std::setfill('0') << std::setw(2) << std::uppercase
+			     << std::hex << slot;
+
+			auto color = schemes[i].colors.find(base.str());
+			palette.emplace_back(color == schemes[i].colors.end() ? "" : color->second);
+		}
+
+		std::vector<float> feature = get_palette_feature(palette);
+		std::copy(feature.begin(), feature.end(),
+		          features.begin() + (long)(i * FEATURE_SIZE));
+	}
+
+	if (opt_threshold >= 0) {
+		std::vector<std::tuple<size_t, size_t, float>> pairs;
+
+#pragma omp parallel for schedule(dynamic) default(none) \
+	shared(schemes, features, opt_threshold, pairs)
+		for (size_t i = 0; i < schemes.size(); ++i) {
+			for (size_t j = i + 1; j < schemes.size(); ++j) {
+				float distance =
+					get_distance(&features[i * FEATURE_SIZE],
+				                     &features[j * FEATURE_SIZE], PALETTE_SIZE);
+
+				if (distance <= opt_threshold) {
+#pragma omp critical
+					pairs.emplace_back(i, j, distance);
+				}
 			}
 		}
+
+		std::sort(pairs.begin(), pairs.end());
+
+		for (const auto &[i, j, distance] : pairs) {
+			std::cout << schemes[i].slug << " " << schemes[j].slug << " " << std::fixed
+				  << std::setprecision(2) << distance << std::endl;
+		}
+
+		return;
+	}
+
+	if (queries.empty())
+		throw std::runtime_error("error: no scheme or color is given");
+
+	std::vector<float> query;
+	size_t size = PALETTE_SIZE;
+	long self = -1;
+
+	auto match = std::find_if(schemes.begin(), schemes.end(),
+	                          [&](const Scheme &s) { return s.slug == queries[0]; });
+
+	if (queries.size() == 1 && match != schemes.end()) {
+		self = match - schemes.begin();
+		query.assign(features.begin() + self * (long)FEATURE_SIZE,
+		             features.begin() + (self + 1) * (long)FEATURE_SIZE);
+	} else {
+		std::vector<std::string> palette;
+
+		for (const std::string &color : queries)
+			palette.emplace_back(color[0] == '#' ? color.substr(1) : color);
+
+		query = get_palette_feature(palette);
+		size = std::min(palette.size(), PALETTE_SIZE);
+
+		for (size_t i = 0; i < size; ++i) {
+			if (std::isnan(query[i]) && queries.size() == 1)
+				throw std::runtime_error("error: unknown scheme: " + queries[i]);
+
+			if (std::isnan(query[i]))
+				throw std::runtime_error("error: invalid color: " + queries[i]);
+		}
+	}
+
+	std::vector<std::pair<float, size_t>> nearest(schemes.size());
+
+#pragma omp parallel for default(none) shared(schemes, features, query, size, self, nearest)
+	for (size_t i = 0; i < schemes.size(); ++i) {
+		float distance = get_distance(query.data(), &features[i * FEATURE_SIZE], size);
+
+		if ((long)i == self || std::isnan(distance))
+			distance = INFINITY;
+
+		nearest[i] = { distance, i };
+	}
+
+	size_t count = std::min(opt_count, nearest.size());
+	std::partial_sort(nearest.begin(), nearest.begin() + (long)count, nearest.end());
+
+	for (size_t i = 0; i < count && std::isfinite(nearest[i].first); ++i) {
+		std::cout << schemes[nearest[i].second].slug << " " << std::fixed
+			  << std::setprecision(2) << nearest[i].first << std::endl;
 	}
 }
 
@@ -633,9 +1557,100 @@ main(int argc, char *argv[]) -> int
 		std::vector<std::string> opt_templates;
 		std::vector<std::string> opt_schemes;
 		std::filesystem::path opt_output = "base16-themes";
+		size_t opt_batch = 0;
+		size_t opt_render_cache = 0;
+		Shard opt_shard = { 0, 1 };
+
+		// NOLINTNEXTLINE (concurrency-mt-unsafe)
+		while ((opt = getopt(argc, argv, "c:t:s:o:b:r:p:")) != EOF) {
+			switch (opt) {
+			case 'c':
+				if (std::filesystem::is_directory(optarg)) {
+					opt_cache_dir = optarg;
+				} else {
+					std::cerr << "error: directory not found: " << optarg
+						  << std::endl;
+					return -ENOTDIR;
+				}
+				break;
+			case 't':
+				index = optind - 1;
+				while (index < argc) {
+					std::string next = args[index];
+					index++;
+					if (next[0] != '-')
+						opt_templates.emplace_back(next);
+					else
+						break;
+				}
+				break;
+			case 's':
+				index = optind - 1;
+				while (index < argc) {
+					std::string next = args[index];
+					index++;
+					if (next[0] != '-')
+						opt_schemes.emplace_back(next);
+					else
+						break;
+				}
+				break;
+			case 'o':
+				opt_output = optarg;
+				break;
+			case 'b':
+				try {
+					opt_batch = std::stoul(optarg);
+				} catch (std::exception &e) {
+					std::cerr << "error: invalid batch size: " << optarg
+						  << std::endl;
+					return -EINVAL;
+				}
+				break;
+			case 'r':
+				try {
+					opt_render_cache = std::stoul(optarg);
+				} catch (std::exception &e) {
+					std::cerr << "error: invalid cache size: " << optarg
+						  << std::endl;
+					return -EINVAL;
+				}
+				break;
+			case 'p':
+				try {
+					std::string shard = optarg;
+					size_t separator = shard.find('/');
+
+					if (separator == std::string::npos)
+						throw std::invalid_argument(shard);
+
+					opt_shard.index = std::stoul(shard.substr(0, separator));
+					opt_shard.count = std::stoul(shard.substr(separator + 1));
+
+					if (opt_shard.index == 0 ||
+					    opt_shard.index > opt_shard.count)
+						throw std::out_of_range(shard);
+
+					opt_shard.index -= 1;
+				} catch (std::exception &e) {
+					std::cerr << "error: invalid shard: " << optarg
+						  << std::endl;
+					return -EINVAL;
+				}
+				break;
+			}
+		}
+
+		build(opt_cache_dir, opt_templates, opt_schemes, "", opt_output, opt_batch,
+		      opt_render_cache, opt_shard, false, false);
+	} else if (std::strcmp(args[optind], "verify") == 0) {
+		std::vector<std::string> opt_templates;
+		std::vector<std::string> opt_schemes;
+		std::filesystem::path opt_output = "base16-themes";
+		size_t opt_batch = 0;
 
 		// NOLINTNEXTLINE (concurrency-mt-unsafe)
-		while ((opt = getopt(argc, argv, "c:t:s:o:")) != EOF) {
+		while ((opt = getopt(argc, argv, "c:t:s:o:b:")) != EOF) {
 			switch (opt) {
 			case 'c':
 				if (std::filesystem::is_directory(optarg)) {
@@ -671,18 +1686,33 @@ main(int argc, char *argv[]) -> int
 			case 'o':
 				opt_output = optarg;
 				break;
+			case 'b':
+				try {
+					opt_batch = std::stoul(optarg);
+				} catch (std::exception &e) {
+					std::cerr << "error: invalid batch size: " << optarg
+						  << std::endl;
+					return -EINVAL;
+				}
+				break;
 			}
 		}
 
-		build(opt_cache_dir, opt_templates, opt_schemes, "", opt_output, false);
+		if (build(opt_cache_dir, opt_templates, opt_schemes, "", opt_output, opt_batch, 0,
+		          { 0, 1 }, true, false) != 0)
+			return 1;
 	} else if (std::strcmp(args[optind], "make") == 0) {
 		std::vector<std::string> opt_templates;
 		std::vector<std::string> opt_schemes;
 		std::filesystem::path opt_build_dir = std::filesystem::current_path();
 		std::filesystem::path opt_output = "";
+		size_t opt_batch = 0;
+		size_t opt_render_cache = 0;
+		Shard opt_shard = { 0, 1 };
+		bool opt_verify = false;
 
 		// NOLINTNEXTLINE (concurrency-mt-unsafe)
-		while ((opt = getopt(argc, argv, "c:C:t:s:o:")) != EOF) {
+		while ((opt = getopt(argc, argv, "c:C:t:s:o:b:r:p:v")) != EOF) {
 			switch (opt) {
 			case 'c':
 				if (std::filesystem::is_directory(optarg)) {
@@ -727,10 +1757,103 @@ main(int argc, char *argv[]) -> int
 			case 'o':
 				opt_output = optarg;
 				break;
+			case 'b':
+				try {
+					opt_batch = std::stoul(optarg);
+				} catch (std::exception &e) {
+					std::cerr << "error: invalid batch size: " << optarg
+						  << std::endl;
+					return -EINVAL;
+				}
+				break;
+			case 'r':
+				try {
+					opt_render_cache = std::stoul(optarg);
+				} catch (std::exception &e) {
+					std::cerr << "error: invalid cache size: " << optarg
+						  << std::endl;
+					return -EINVAL;
+				}
+				break;
+			case 'p':
+				try {
+					std::string shard = optarg;
+					size_t separator = shard.find('/');
+
+					if (separator == std::string::npos)
+						throw std::invalid_argument(shard);
+
+					opt_shard.index = std::stoul(shard.substr(0, separator));
+					opt_shard.count = std::stoul(shard.substr(separator + 1));
+
+					if (opt_shard.index == 0 ||
+					    opt_shard.index > opt_shard.count)
+						throw std::out_of_range(shard);
+
+					opt_shard.index -= 1;
+				} catch (std::exception &e) {
+					std::cerr << "error: invalid shard: " << optarg
+						  << std::endl;
+					return -EINVAL;
+				}
+				break;
+			case 'v':
+				opt_verify = true;
+				break;
 			}
 		}
 
-		build(opt_cache_dir, opt_templates, opt_schemes, opt_build_dir, opt_output, true);
+		if (build(opt_cache_dir, opt_templates, opt_schemes, opt_build_dir, opt_output,
+		          opt_batch, opt_render_cache, opt_shard, opt_verify, true) != 0)
+			return 1;
+	} else if (std::strcmp(args[optind], "similar") == 0) {
+		std::vector<std::string> queries;
+		size_t opt_count = 10;
+		float opt_threshold = -1;
+
+		// NOLINTNEXTLINE (concurrency-mt-unsafe)
+		while ((opt = getopt(argc, argv, "c:k:d:")) != EOF) {
+			switch (opt) {
+			case 'c':
+				if (std::filesystem::is_directory(optarg)) {
+					opt_cache_dir = optarg;
+				} else {
+					std::cerr << "error: directory not found: " << optarg
+						  << std::endl;
+					return -ENOTDIR;
+				}
+				break;
+			case 'k':
+				try {
+					opt_count = std::stoul(optarg);
+				} catch (std::exception &e) {
+					std::cerr << "error: invalid count: " << optarg
+						  << std::endl;
+					return -EINVAL;
+				}
+				break;
+			case 'd':
+				try {
+					opt_threshold = std::stof(optarg);
+				} catch (std::exception &e) {
+					std::cerr << "error: invalid threshold: " << optarg
+						  << std::endl;
+					return -EINVAL;
+				}
+				break;
+			}
+		}
+
+		// getopt moves operands behind the options, the first one is the command itself
+		for (int i = optind + 1; i < argc; ++i)
+			queries.emplace_back(args[i]);
+
+		try {
+			similar(opt_cache_dir, queries, opt_count, opt_threshold);
+		} catch (std::runtime_error &e) {
+			std::cerr << e.what() << std::endl;
+			return -EINVAL;
+		}
 	} else if (std::strcmp(args[optind], "list") == 0) {
 		bool opt_show_template = true;
 		bool opt_show_scheme = true;
@@ -764,13 +1887,15 @@ main(int argc, char *argv[]) -> int
 
 		list(opt_cache_dir, opt_show_template, opt_show_scheme, opt_raw);
 	} else if (std::strcmp(args[optind], "version") == 0) {
-		std::cout << "cbase16-0.5.4" << std::endl;
+		std::cout << "cbase16-" << VERSION << std::endl;
 	} else if (std::strcmp(args[optind], "help") == 0) {
 		std::cout << "usage: cbase16 [command] [options]\n\n"
 			     "command:\n"
 			     "   update  -- fetch all necessary sources for building\n"
 			     "   build   -- generate colorscheme templates\n"
 			     "   make    -- build current directory\n"
+			     "   verify  -- check built templates without writing\n"
+			     "   similar -- find schemes with a similar palette\n"
 			     "   list    -- display available schemes and templates\n"
 			     "   version -- display version\n"
 			     "   help    -- display usage message\n\n"
@@ -781,13 +1906,30 @@ main(int argc, char *argv[]) -> int
 			     "   -c -- specify cache directory\n"
 			     "   -s -- only build specified schemes\n"
 			     "   -t -- only build specified templates\n"
-			     "   -o -- specify output directory\n\n"
+			     "   -o -- specify output directory\n"
+			     "   -b -- load schemes in batches of given size\n"
+			     "   -r -- cache rendered templates up to given size in MiB\n"
+			     "   -p -- only build shard i of n, given as i/n\n\n"
+			     "verify options:\n"
+			     "   -c -- specify cache directory\n"
+			     "   -s -- only verify specified schemes\n"
+			     "   -t -- only verify specified templates\n"
+			     "   -o -- specify output directory\n"
+			     "   -b -- load schemes in batches of given size\n\n"
 			     "make options:\n"
 			     "   -c -- specify cache directory\n"
 			     "   -C -- specify directory to build\n"
 			     "   -s -- only build specified schemes\n"
 			     "   -t -- only build specified templates\n"
-			     "   -o -- specify output directory\n\n"
+			     "   -o -- specify output directory\n"
+			     "   -b -- load schemes in batches of given size\n"
+			     "   -r -- cache rendered templates up to given size in MiB\n"
+			     "   -p -- only build shard i of n, given as i/n\n"
+			     "   -v -- verify output instead of writing\n\n"
+			     "similar options:\n"
+			     "   -c -- specify cache directory\n"
+			     "   -k -- number of schemes to show\n"
+			     "   -d -- list scheme pairs within given distance\n\n"
 			     "list options:\n"
 			     "   -c -- specify cache directory\n"
 			     "   -s -- only show schemes\n"
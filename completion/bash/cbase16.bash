@@ -1,11 +1,15 @@
 #!/usr/bin/env bash
 
 _cbase16_completion() {
-	COMPREPLY=($(compgen -W "update build make list version help" "${COMP_WORDS[1]}"))
+	COMPREPLY=($(compgen -W "update build make verify similar list version help" "${COMP_WORDS[1]}"))
 	if [[ "${COMP_WORDS[1]}" = "build" ]]; then
-		COMPREPLY=($(compgen -W "-c -s -t -o" "${COMP_WORDS[2]}"))
+		COMPREPLY=($(compgen -W "-c -s -t -o -b -r -p" "${COMP_WORDS[2]}"))
+	elif [[ "${COMP_WORDS[1]}" = "verify" ]]; then
+		COMPREPLY=($(compgen -W "-c -s -t -o -b" "${COMP_WORDS[2]}"))
+	elif [[ "${COMP_WORDS[1]}" = "similar" ]]; then
+		COMPREPLY=($(compgen -W "-c -k -d $(cbase16 list -s -r)" "${COMP_WORDS[2]}"))
 	elif [[ "${COMP_WORDS[1]}" = "make" ]]; then
-		COMPREPLY=($(compgen -W "-c -C -s -t -o" "${COMP_WORDS[2]}"))
+		COMPREPLY=($(compgen -W "-c -C -s -t -o -b -r -p -v" "${COMP_WORDS[2]}"))
 	fi
 }
 